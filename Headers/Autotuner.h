@@ -0,0 +1,72 @@
+#pragma once
+#include "Tools.h"
+#include "Image.h"
+#include "Canny.h"
+#include "Gaussian.h"
+
+#include <string>
+#include <vector>
+
+/*
+* Autotuner class
+* Benchmarks the Canny pipeline configurations (band height and thread count) on
+* representative image sizes and keeps the fastest ones in a profile file. Only the
+* settings, which don't change the output, are tuned. They don't depend on the sigma,
+* so the profile is keyed by the image size and the Gaussian method only. Normal runs
+* load the profile and pick the entry of their method closest to the image size.
+*/
+class Autotuner
+{
+public:
+
+	// Fastest configuration for one image size and Gaussian method
+	struct Entry {
+		int width;
+		int height;
+		Gaussian::Method gaussMethod;
+		int bandHeight;
+		int threads;
+		double time_ms;
+	};
+
+	Autotuner(const string &file = "edge_profile.txt") : profileFile(file) {}
+
+	const string &file() const { return profileFile; }
+
+	/*
+	* Benchmark the candidate configurations with the given Canny parameters and
+	* replace the entries of the same Gaussian method in the profile.
+	*/
+	void tune(const int gaussize, const double gaussigma, const Gaussian::Method gaussMethod, const int weakThreshold, const int strongThreshold);
+
+	// Read the profile file, false if it doesn't exist or can't be read
+	bool load();
+
+	// Write the profile file
+	bool save() const;
+
+	/*
+	* Find the entry of the same Gaussian method, which image size is closest to w x h.
+	* Returns false if there is none.
+	*/
+	bool select(const int w, const int h, const Gaussian::Method gaussMethod, Entry &entry) const;
+
+	// Apply the configuration of the entry to Canny
+	static void apply(const Entry &entry, Canny &canny);
+
+	// Short description, i.e. "mask Gaussian, band 64, threads 8"
+	static string describe(const Entry &entry);
+
+	// Name of the method in the profile and on the command line, i.e. "mask"
+	static string methodName(const Gaussian::Method method);
+
+private:
+	string profileFile;
+	vector<Entry> entries;
+
+	// Representative document-like test image: text blocks on paper with some noise
+	static Image<uchar> testImage(const int w, const int h);
+
+	// Best time of the rounds in milliseconds. Canny is a copy of base with the configuration applied.
+	static double measure(const Image<uchar> &img, const Entry &config, const Canny &base, const int rounds = 3);
+};
@@ -3,6 +3,7 @@
 #include "Tools.h"
 #include "Sobel.h"
 #include "Gaussian.h"
+#include "Image.h"
 
 #include <cmath>
 #include <vector>
@@ -16,23 +17,97 @@
 */
 class Canny
 {
+public:
+
+	// Threshold selection. FIXED uses the given thresholds, others select the strong
+	// threshold from the histogram of the non-maximum suppressed gradients.
+	enum ThresholdMode { FIXED, OTSU, PERCENTILE };
+
+private:
+
 	int _gaussize;
 	double _gaussigma;
 	int _weakThreshold;
 	int _strongThreshold;
 
-	vector<vector<double> > gradient_dir;
+	// Coarse-to-fine mode: downsampling factor (1 = off)
+	int _accelerate;
+
+	// Automatic thresholds: weak = ratio * strong, percentile is used by PERCENTILE mode
+	ThresholdMode _thresholdMode;
+	double _thresholdRatio;
+	double _thresholdPercentile;
+
+	// Threads of the row parallel stages and the height of the row bands they process
+	int _threads;
+	int _bandHeight;
+
+	// Gaussian filter selection
+	Gaussian::Method _gaussMethod;
+
+	Image<double> gradient_dir;
+
+	// Histogram of the gradients left by non-maximum suppression (0 excluded)
+	vector<uint> histogram;
+
+	// Bit per pixel: gradient is a candidate for an edge. 64 pixels per word, one row per image row.
+	// Sobel pass sets the bits and non-maximum suppression clears the suppressed ones.
+	Image<uint64_t> candidates;
 
 public:
 
 	// Default values
-	Canny() : _gaussize(5), _gaussigma(0.5), _weakThreshold(20), _strongThreshold(35) {}
+	Canny() : _gaussize(5), _gaussigma(0.5), _weakThreshold(20), _strongThreshold(35), _accelerate(1),
+		_thresholdMode(FIXED), _thresholdRatio(0.5), _thresholdPercentile(0.9), _threads(Tools::hardwareThreads()), _bandHeight(64), _gaussMethod(Gaussian::FIR) {}
 
 	
 	// Canny recommended a upper:lower ratio between 2:1 and 3:1.
 	// As gaussiam matrix is often used 5x5 and sigma between 0.2 - 2.0. 
 	// Lower sigma = sharper image
-	Canny(int size, double sig, int wt, int ht) : _gaussize(size), _gaussigma(sig), _weakThreshold(wt), _strongThreshold(ht) { }
+	Canny(int size, double sig, int wt, int ht) : _gaussize(size), _gaussigma(sig), _weakThreshold(wt), _strongThreshold(ht), _accelerate(1),
+		_thresholdMode(FIXED), _thresholdRatio(0.5), _thresholdPercentile(0.9), _threads(Tools::hardwareThreads()), _bandHeight(64), _gaussMethod(Gaussian::FIR) { }
+
+	/*
+	* Enable coarse-to-fine detection. The image is first examined at 1/factor resolution
+	* and the full resolution pipeline is run only in the regions, which may contain edges.
+	* Regions are selected from the local contrast of the image, so the result is identical to the full detection.
+	* factor = 1 disables the mode.
+	*/
+	void setAccelerate(const int factor) {
+		_accelerate = max(factor, 1);
+	}
+
+	/*
+	* Select the thresholds from the image. Histogram is collected during non-maximum suppression.
+	* - OTSU: strong threshold splits the gradients to two classes with Otsu's method
+	* - PERCENTILE: strong threshold is the given percentile [0 - 1] of the gradients
+	* Weak threshold is ratio * strong threshold.
+	* Coarse-to-fine mode needs the thresholds beforehand, so it is not used with automatic thresholds.
+	*/
+	void setAutoThreshold(const ThresholdMode mode, const double ratio = 0.5, const double percentile = 0.9) {
+		_thresholdMode = mode;
+		_thresholdRatio = ratio;
+		_thresholdPercentile = percentile;
+	}
+
+	// Number of threads, which process the image rows
+	void setThreads(const int threads) {
+		_threads = max(threads, 1);
+	}
+
+	// Rows per band, which a thread processes at once
+	void setBandHeight(const int rows) {
+		_bandHeight = max(rows, 1);
+	}
+
+	// Select the mask (default) or the recursive Gaussian
+	void setGaussianMethod(const Gaussian::Method method) {
+		_gaussMethod = method;
+	}
+
+	// Thresholds used by the last perform (selected ones in automatic mode)
+	int weakThreshold() const { return _weakThreshold; }
+	int strongThreshold() const { return _strongThreshold; }
 
 
 	/*
@@ -40,18 +115,129 @@ public:
 	*/
 	CImg<uchar> perform(const CImg<uchar> &img)
 	{
+		return perform(Image<uchar>::fromCImg(img)).toCImg();
+	}
+
+	Image<uchar> perform(const Image<uchar> &img)
+	{
+		if (_accelerate > 1 && _thresholdMode == FIXED) {
+			return performCoarseToFine(img);
+		}
+
 		// 1. Filter out noise
-		Gaussian gaussian = Gaussian(_gaussize, _gaussigma);
-		CImg<uchar> smooth_img = gaussian.filter_image(img);
+		Image<uchar> smooth_img;
+		smoothImage(Gaussian(_gaussize, _gaussigma, _gaussMethod), img, smooth_img);
+
+		return performSmoothed(smooth_img);
+	}
+
+	/*
+	* Steps 2 - 4 of the edgedetection from the smoothed image
+	*/
+	Image<uchar> performSmoothed(const Image<uchar> &smooth_img)
+	{
+		// Only gradients over the lower threshold can become edges. Automatic thresholds are
+		// not known yet, so then all non-zero gradients are candidates.
+		const int candidateThreshold = (_thresholdMode == FIXED) ? min(_weakThreshold, _strongThreshold) : 1;
+		const bool sparse = candidateThreshold > 0;
 
 		// 2.  intensity gradient of the image
-		CImg<uchar> sobel_img = create_intensity_gradient(smooth_img);
+		Image<uchar> sobel_img;
+		create_intensity_gradient(smooth_img, sobel_img, sparse ? candidateThreshold : 0);
 
 		// 3. non-maximum suppression
-		CImg<uchar> supp_img = nonMaximumSuppression(sobel_img);
+		Image<uchar> supp_img;
+		if (sparse) {
+			nonMaximumSuppressionSparse(sobel_img, supp_img);
+		}
+		else {
+			nonMaximumSuppression(sobel_img, supp_img);
+		}
+		if (_thresholdMode != FIXED) {
+			selectThresholds();
+		}
 
 		// 4. Thresholding
-		CImg<uchar> final_img = threshold_image(supp_img, _weakThreshold, _strongThreshold);
+		Image<uchar> final_img;
+		if (sparse) {
+			threshold_image_sparse(supp_img, final_img, _weakThreshold, _strongThreshold);
+		}
+		else {
+			threshold_image(supp_img, final_img, _weakThreshold, _strongThreshold);
+		}
+
+		return final_img;
+	}
+
+	/*
+	* Coarse-to-fine edgedetection.
+	* Every stage is calculated only in the tiles found from the downsampled image,
+	* expanded by the number of pixels the later stages read around each pixel.
+	*/
+	Image<uchar> performCoarseToFine(const Image<uchar> &img)
+	{
+		const int w = img.width();
+		const int h = img.height();
+		Gaussian gaussian = Gaussian(_gaussize, _gaussigma, _gaussMethod);
+		Image<uchar> smooth_img;
+
+		// 1. Regions of interest
+		// Recursive filter can't be limited to the regions, so it is run first and the contrast
+		// is read directly from the smoothed image.
+		Image<uchar> tiles;
+		if (gaussian.recursive()) {
+			gaussian.filter_image(img, smooth_img);
+			findContrastTiles(smooth_img, 2, 1.0, 0.0, smooth_img.area(), tiles);
+		}
+		else {
+			const int fs = gaussian.radius();
+			findContrastTiles(img, fs + 2, gaussian.gain(), 1.0, Area(fs, fs, w - fs, h - fs), tiles);
+		}
+
+		// Most of the image is selected, plain pipeline is cheaper
+		int selected = 0;
+		for (int ty = 0; ty < tiles.height(); ty++) {
+			for (int tx = 0; tx < tiles.width(); tx++) {
+				selected += tiles(tx, ty) ? 1 : 0;
+			}
+		}
+		if (selected * 4 >= tiles.width() * tiles.height() * 3) {
+			if (!gaussian.recursive()) {
+				smoothImage(gaussian, img, smooth_img);
+			}
+			return performSmoothed(smooth_img);
+		}
+
+		// 2. Full resolution pipeline inside the regions
+		// Each stage reads one pixel around, so the earlier stages cover wider areas.
+		// Areas of one stage don't overlap, so they are shared between the threads.
+		// The planes are not cleared: every stage writes all pixels of its areas and only the
+		// borders, which the stages leave untouched, are set to zero.
+		Image<uchar> sobel_img, supp_img, final_img(w, h);
+		sobel_img.allocate(w, h);
+		supp_img.allocate(w, h);
+		sobel_img.fillBorder(1, 0);
+		supp_img.fillBorder(1, 0);
+		gradient_dir.allocate(w, h);
+
+		if (!gaussian.recursive()) {
+			smooth_img.allocate(w, h);
+			smooth_img.fillBorder(gaussian.radius(), 0);
+
+			const vector<Area> gaussAreas = tileAreas(tiles, 3, w, h);
+			parallelAreas(gaussAreas, [&](const Area &a) {
+				gaussian.filter_image(img, smooth_img, a);
+			});
+		}
+		parallelAreas(tileAreas(tiles, 2, w, h), [&](const Area &a) {
+			Sobel::sobelAlgorithm(smooth_img, sobel_img, gradient_dir, a, Sobel::EdgeStrengthMode::DIAGONAL);
+		});
+		parallelAreas(tileAreas(tiles, 1, w, h), [&](const Area &a) {
+			nonMaximumSuppression(sobel_img, supp_img, a);
+		});
+		parallelAreas(tileAreas(tiles, 0, w, h), [&](const Area &a) {
+			threshold_image(supp_img, final_img, _weakThreshold, _strongThreshold, a);
+		});
 
 		return final_img;
 	}
@@ -62,90 +248,446 @@ public:
 	* - Rounds points to grayValue which are over or equal to strongThreshold.
 	* - Removes points which are over weakThreshold but under strongThreshold if they don't have neighbour which is strong pixel.
 	*/
-	CImg<uchar> threshold_image(const CImg<uchar> &img, const int weakThreshold, const int strongThreshold, const uchar grayValue=255) {
-		return Tools::filter(img, [&](int x, int y) -> int {
+	void threshold_image(const Image<uchar> &img, Image<uchar> &out, const int weakThreshold, const int strongThreshold, const uchar grayValue=255) {
+		out.resize(img.width(), img.height());
+		threshold_image(img, out, weakThreshold, strongThreshold, img.area(), grayValue);
+	}
 
-			if (img(x, y) >= strongThreshold) {
-				return grayValue;
-			}
-			else if (img(x, y) >= weakThreshold) {
-				const int plusX[] = { 1,1,1,0,0,-1,-1,-1 };
-				const int plusY[] = { 0,-1,1,-1,1,-1,0,1 };
-				for (int i = 0; i < 8; i++) {
-					const int px = plusX[i] + x;
-					const int py = plusY[i] + y;
-					if (px < 0 || py < 0 || px >= img.width() || py >= img.height()) continue;
-					if (img(px, py) >= strongThreshold) {
-						return grayValue;
+	// Threshold only the pixels of the area. out has to be allocated to the size of img.
+	void threshold_image(const Image<uchar> &img, Image<uchar> &out, const int weakThreshold, const int strongThreshold, const Area &area, const uchar grayValue=255) {
+		const Area a = area.clip(Area(1, 1, img.width() - 1, img.height() - 1));
+		for (int y = a.y0; y < a.y1; y++) {
+			const uchar *r0 = img.row(y - 1);
+			const uchar *r1 = img.row(y);
+			const uchar *r2 = img.row(y + 1);
+			uchar *dst = out.row(y);
+
+			for (int x = a.x0; x < a.x1; x++) {
+				if (r1[x] >= strongThreshold) {
+					dst[x] = grayValue;
+				}
+				else if (r1[x] >= weakThreshold) {
+					if (r0[x - 1] >= strongThreshold || r0[x] >= strongThreshold || r0[x + 1] >= strongThreshold ||
+						r1[x - 1] >= strongThreshold || r1[x + 1] >= strongThreshold ||
+						r2[x - 1] >= strongThreshold || r2[x] >= strongThreshold || r2[x + 1] >= strongThreshold) {
+						dst[x] = grayValue;
 					}
 				}
 			}
-			return 0;
-		});
+		}
 	}
 
 
+	/*
+	* Thresholding of the candidate pixels only. candidates has to be left by nonMaximumSuppressionSparse.
+	* Result is the same as threshold_image gives, when the weak threshold is over zero.
+	*/
+	void threshold_image_sparse(const Image<uchar> &img, Image<uchar> &out, const int weakThreshold, const int strongThreshold, const uchar grayValue=255) {
+		out.resize(img.width(), img.height());
+
+		Tools::parallelRows(1, img.height() - 1, _threads, [&](int y0, int y1, int) {
+			for (int y = y0; y < y1; y++) {
+				const uchar *r0 = img.row(y - 1);
+				const uchar *r1 = img.row(y);
+				const uchar *r2 = img.row(y + 1);
+				const uint64_t *mask = candidates.row(y);
+				uchar *dst = out.row(y);
+
+				for (int i = 0; i < candidates.width(); i++) {
+					uint64_t bits = mask[i];
+					while (bits) {
+						const int x = i * 64 + Tools::lowestBit(bits);
+						bits &= bits - 1;
+
+						if (r1[x] >= strongThreshold) {
+							dst[x] = grayValue;
+						}
+						else if (r1[x] >= weakThreshold) {
+							if (r0[x - 1] >= strongThreshold || r0[x] >= strongThreshold || r0[x + 1] >= strongThreshold ||
+								r1[x - 1] >= strongThreshold || r1[x + 1] >= strongThreshold ||
+								r2[x - 1] >= strongThreshold || r2[x] >= strongThreshold || r2[x + 1] >= strongThreshold) {
+								dst[x] = grayValue;
+							}
+						}
+					}
+				}
+			}
+		}, _bandHeight);
+	}
+
 	/*
 	* nonMaximumSuppression
 	* Function removes pixels which are weaker than the gradiet shown neighbours.
 	* i.e. if gradient is up, and the UP or Down pixel is stronger than middle, middle pixel gets removed.
 	*/
-	CImg<uchar> nonMaximumSuppression(const CImg<uchar> &img) {
-		CImg<uchar> fimg = Tools::filter(img, [&](int x, int y) -> int {
-			const double ang = roundAngleTo(gradient_dir[y][x]);
+	void nonMaximumSuppression(const Image<uchar> &img, Image<uchar> &out) {
+		const int w = img.width();
+		out.resize(w, img.height());
+
+		// Every thread counts its own histogram, which are summed afterwards
+		const bool collect = (_thresholdMode != FIXED);
+		vector<vector<uint> > hists(collect ? _threads : 0, vector<uint>(256, 0));
+
+		Tools::parallelRows(0, img.height(), _threads, [&](int y0, int y1, int t) {
+			nonMaximumSuppression(img, out, Area(0, y0, w, y1), collect ? &hists[t][0] : 0);
+		}, _bandHeight);
+
+		mergeHistograms(hists);
+	}
+
+	// Suppress only the pixels of the area, every pixel of it is written. out has to be allocated to the size of img.
+	// If hist is given, the remaining non-zero gradients are counted to it (256 bins).
+	void nonMaximumSuppression(const Image<uchar> &img, Image<uchar> &out, const Area &area, uint *hist = 0) {
+		const Area a = area.clip(Area(1, 1, img.width() - 1, img.height() - 1));
+		for (int y = a.y0; y < a.y1; y++) {
+			const uchar *src = img.row(y);
+			const double *dir = gradient_dir.row(y);
+			uchar *dst = out.row(y);
+
+			for (int x = a.x0; x < a.x1; x++) {
+				if (isLocalMaximum(img, x, y, dir[x])) {
+					dst[x] = src[x];
+					if (hist) hist[src[x]]++;
+				}
+				else {
+					dst[x] = 0;
+				}
+			}
+		}
+	}
+
+	/*
+	* Non-maximum suppression of the candidate pixels only. candidates has to be set by
+	* create_intensity_gradient. Bits of the suppressed pixels are cleared.
+	*/
+	void nonMaximumSuppressionSparse(const Image<uchar> &img, Image<uchar> &out) {
+		out.resize(img.width(), img.height());
+
+		const bool collect = (_thresholdMode != FIXED);
+		vector<vector<uint> > hists(collect ? _threads : 0, vector<uint>(256, 0));
+
+		Tools::parallelRows(1, img.height() - 1, _threads, [&](int y0, int y1, int t) {
+			uint *hist = collect ? &hists[t][0] : 0;
+			for (int y = y0; y < y1; y++) {
+				const uchar *src = img.row(y);
+				const double *dir = gradient_dir.row(y);
+				uint64_t *mask = candidates.row(y);
+				uchar *dst = out.row(y);
 
-			const uchar front = (int)getNeighbourPixel(img, x, y, ang);
-			const uchar back = (int)getNeighbourPixel(img, x, y, -ang);
+				for (int i = 0; i < candidates.width(); i++) {
+					uint64_t bits = mask[i];
+					uint64_t keep = bits;
+					while (bits) {
+						const int b = Tools::lowestBit(bits);
+						const int x = i * 64 + b;
+						bits &= bits - 1;
 
-			if (front > img(x, y) || back > img(x, y)) {
-				return 0;
+						if (isLocalMaximum(img, x, y, dir[x])) {
+							dst[x] = src[x];
+							if (hist) hist[src[x]]++;
+						}
+						else {
+							keep &= ~((uint64_t)1 << b);
+						}
+					}
+					mask[i] = keep;
+				}
 			}
+		}, _bandHeight);
 
-			return img(x, y);
-		});
-		
-		return fimg;
+		mergeHistograms(hists);
 	}
 
 	/*
 	* Intensity gradient
 	* Calculates the stregth of changes in the picture and the direction of the gradients.
+	* If candidateThreshold is over zero, the gradients at or over it are marked to candidates
+	* right after each band is calculated, while the band is still in the cache.
 	*/
-	CImg<uchar> create_intensity_gradient(const CImg<uchar> &img) {
-		CImg<uchar> sobel_img = Sobel::sobelAlgorithm(img, gradient_dir, Sobel::EdgeStrengthMode::DIAGONAL);
-		return sobel_img;
+	void create_intensity_gradient(const Image<uchar> &img, Image<uchar> &out, const int candidateThreshold = 0) {
+		const int w = img.width();
+		out.resize(w, img.height());
+		gradient_dir.resize(w, img.height());
+		if (candidateThreshold > 0) {
+			candidates.resize((w + 63) / 64, img.height());
+		}
+
+		Tools::parallelRows(0, img.height(), _threads, [&](int y0, int y1, int) {
+			Sobel::sobelAlgorithm(img, out, gradient_dir, Area(0, y0, w, y1), Sobel::EdgeStrengthMode::DIAGONAL);
+			if (candidateThreshold > 0) {
+				markCandidates(out, y0, y1, candidateThreshold);
+			}
+		}, _bandHeight);
+	}
+
+	/*
+	* Set the thresholds from the histogram of the suppressed gradients.
+	* Zero bin is not counted, as flat areas would dominate the histogram.
+	*/
+	void selectThresholds() {
+		double total = 0, sum = 0;
+		for (int i = 1; i < 256; i++) {
+			total += histogram[i];
+			sum += (double)i * histogram[i];
+		}
+		if (total == 0) return;
+
+		int strong = _strongThreshold;
+		if (_thresholdMode == OTSU) {
+			// Maximize the between class variance. Gradients over the split value are strong.
+			double wB = 0, sumB = 0, best = -1;
+			for (int t = 1; t < 255; t++) {
+				wB += histogram[t];
+				sumB += (double)t * histogram[t];
+				const double wF = total - wB;
+				if (wB == 0) continue;
+				if (wF == 0) break;
+
+				const double diff = sumB / wB - (sum - sumB) / wF;
+				const double between = wB * wF * diff * diff;
+				if (between > best) {
+					best = between;
+					strong = t + 1;
+				}
+			}
+		}
+		else if (_thresholdMode == PERCENTILE) {
+			double cumulative = 0;
+			for (int t = 1; t < 256; t++) {
+				cumulative += histogram[t];
+				if (cumulative >= _thresholdPercentile * total) {
+					strong = t;
+					break;
+				}
+			}
+		}
+
+		_strongThreshold = strong;
+		_weakThreshold = max((int)(_thresholdRatio * strong + 0.5), 1);
 	}
 
 private:
 
-	// Function gets the neighbour from the given direction. 
-	// Ang = 0 is Right, Pi/4 is up, etc.
-	uchar getNeighbourPixel(const CImg<uchar> &img, const int x, const int y, const double ang) const {
-		const int nx = x + (int)round(cos(ang));
-		const int ny = y - (int)round(sin(ang));
+	// Smooth the whole image. Mask is run in parallel row bands, the recursive filter as a whole.
+	void smoothImage(const Gaussian &gaussian, const Image<uchar> &img, Image<uchar> &smooth_img) const {
+		if (gaussian.recursive()) {
+			gaussian.filter_image(img, smooth_img);
+			return;
+		}
+		smooth_img.resize(img.width(), img.height());
+		Tools::parallelRows(0, img.height(), _threads, [&](int y0, int y1, int) {
+			gaussian.filter_image(img, smooth_img, Area(0, y0, img.width(), y1));
+		}, _bandHeight);
+	}
+
+	// Side of the square tiles, which are used to select the full resolution regions
+	static int roiTileSize() { return 16; }
+
+	/*
+	* Region search.
+	* Min and max of the image are collected to 1/factor resolution. A tile is selected, if
+	* the contrast around it allows any pixel next to the tile to reach the strong threshold:
+	* Gaussian limits the contrast to gain * (max - min) + slack (rounding) and the Sobel
+	* response of the contrast c is at most sqrt(2) * 4 * c.
+	* - halo: pixels around the tile, which affect the Sobel values next to the tile
+	* - smoothArea: smoothed plane is zero outside this area, so tiles near it always contain a step
+	*/
+	void findContrastTiles(const Image<uchar> &img, const int halo, const double gain, const double slack, const Area &smoothArea, Image<uchar> &tiles) const {
+		const int f = _accelerate;
+		const int ts = roiTileSize();
+		const int w = img.width();
+		const int h = img.height();
+
+		tiles.resize((w + ts - 1) / ts, (h + ts - 1) / ts);
+
+		// Filtered values may overflow, nothing can be excluded
+		if (gain * 255.0 >= 256.0) {
+			tiles.fill(1);
+			return;
+		}
+
+		// Coarse min and max planes, one coarse row at a time. The f rows are first reduced
+		// column by column in 64 pixel chunks, and the chunks are then reduced to the coarse cells.
+		// Image rows are padded to 64 pixels, so every chunk is read whole and the column loops vectorize.
+		const int cw = (w + f - 1) / f;
+		const int ch = (h + f - 1) / f;
+		Image<uchar> cmin, cmax;
+		cmin.allocate(cw, ch);
+		cmax.allocate(cw, ch);
+		for (int cy = 0; cy < ch; cy++) {
+			const int y0 = cy * f;
+			const int y1 = min(y0 + f, h);
+			uchar *lo = cmin.row(cy);
+			uchar *hi = cmax.row(cy);
+
+			for (int x0 = 0; x0 < w; x0 += 64) {
+				uchar colMin[64], colMax[64];
+				const uchar *first = img.row(y0) + x0;
+				for (int i = 0; i < 64; i++) {
+					colMin[i] = first[i];
+					colMax[i] = first[i];
+				}
+				for (int y = y0 + 1; y < y1; y++) {
+					const uchar *src = img.row(y) + x0;
+					for (int i = 0; i < 64; i++) {
+						const uchar v = src[i];
+						colMin[i] = (v < colMin[i]) ? v : colMin[i];
+						colMax[i] = (v > colMax[i]) ? v : colMax[i];
+					}
+				}
+
+				// 64 is a multiple of f, so the cells don't cross the chunks. Padding is left out.
+				const int n = min(64, w - x0);
+				for (int i = 0; i < n; i += f) {
+					uchar l = colMin[i], u = colMax[i];
+					for (int j = i + 1; j < min(i + f, n); j++) {
+						l = min(l, colMin[j]);
+						u = max(u, colMax[j]);
+					}
+					lo[(x0 + i) / f] = l;
+					hi[(x0 + i) / f] = u;
+				}
+			}
+		}
+
+		for (int ty = 0; ty < tiles.height(); ty++) {
+			for (int tx = 0; tx < tiles.width(); tx++) {
+				const Area tile(tx * ts, ty * ts, min((tx + 1) * ts, w), min((ty + 1) * ts, h));
+				if (!smoothArea.contains(tile.expand(2))) {
+					tiles(tx, ty) = 1;
+					continue;
+				}
+
+				const Area src = tile.expand(halo).clip(img.area());
+				int lo = 255, hi = 0;
+				for (int cy = src.y0 / f; cy <= (src.y1 - 1) / f; cy++) {
+					for (int cx = src.x0 / f; cx <= (src.x1 - 1) / f; cx++) {
+						lo = min(lo, (int)cmin(cx, cy));
+						hi = max(hi, (int)cmax(cx, cy));
+					}
+				}
+
+				const double contrast = gain * (hi - lo) + slack;
+				tiles(tx, ty) = (sqrt(2.0) * 4.0 * contrast + 0.5 >= _strongThreshold) ? 1 : 0;
+			}
+		}
+	}
 
-		// neighbour out of area, return current pixel
-		if (nx < 0 || ny < 0 || nx >= img.width() || ny >= img.height()) {
-			return img(x, y);
+	/*
+	* Areas covering the selected tiles expanded by k pixels (k < tile size).
+	* Every tile row is split to bands, which are next to the same neighbour rows,
+	* so the areas don't overlap and no pixel is calculated twice.
+	*/
+	vector<Area> tileAreas(const Image<uchar> &tiles, const int k, const int w, const int h) const {
+		const int ts = roiTileSize();
+		vector<Area> areas;
+		vector<uchar> active(tiles.width());
+
+		for (int ty = 0; ty < tiles.height(); ty++) {
+			const int y0 = ty * ts;
+			const int y1 = min(y0 + ts, h);
+			const uchar *up = (ty > 0) ? tiles.row(ty - 1) : 0;
+			const uchar *mid = tiles.row(ty);
+			const uchar *down = (ty + 1 < tiles.height()) ? tiles.row(ty + 1) : 0;
+
+			// Rows of the first tile row are expanded upwards and the last downwards
+			int y = (ty == 0) ? y0 - k : y0;
+			const int yEnd = (ty + 1 == tiles.height()) ? y1 + k : y1;
+			while (y < yEnd) {
+				const bool useUp = up && y < y0 + k;
+				const bool useDown = down && y >= y1 - k;
+				int bandEnd = y + 1;
+				while (bandEnd < yEnd && (up && bandEnd < y0 + k) == useUp && (down && bandEnd >= y1 - k) == useDown) bandEnd++;
+
+				for (int tx = 0; tx < tiles.width(); tx++) {
+					active[tx] = mid[tx] || (useUp && up[tx]) || (useDown && down[tx]);
+				}
+
+				int tx = 0;
+				while (tx < tiles.width()) {
+					if (!active[tx]) {
+						tx++;
+						continue;
+					}
+					const int start = tx;
+					while (tx < tiles.width() && active[tx]) tx++;
+					areas.push_back(Area(start * ts - k, y, min(tx * ts, w) + k, bandEnd));
+				}
+				y = bandEnd;
+			}
+		}
+		return areas;
+	}
+
+	// Run func for every area. Threads take the areas in groups of 8 from a shared counter.
+	void parallelAreas(const vector<Area> &areas, const std::function<void(const Area&)> &func) const {
+		Tools::parallelRows(0, (int)areas.size(), _threads, [&](int i0, int i1, int) {
+			for (int i = i0; i < i1; i++) {
+				func(areas[i]);
+			}
+		}, 8);
+	}
+
+	// Set the candidate bits of the rows [y0, y1) from the gradients at or over the threshold.
+	// Sobel leaves the border pixels zero, so border bits are never set.
+	void markCandidates(const Image<uchar> &img, const int y0, const int y1, const int threshold) {
+		const int w = img.width();
+		for (int y = y0; y < y1; y++) {
+			const uchar *src = img.row(y);
+			uint64_t *mask = candidates.row(y);
+			for (int i = 0; i < candidates.width(); i++) {
+				const int x0 = i * 64;
+				const int n = min(64, w - x0);
+				uint64_t bits = 0;
+				for (int b = 0; b < n; b++) {
+					bits |= (uint64_t)(src[x0 + b] >= threshold) << b;
+				}
+				mask[i] = bits;
+			}
+		}
+	}
+
+	/*
+	* Is the gradient at (x, y) at least as strong as its neighbours in the gradient direction ang.
+	* Neighbour offsets for the rounded directions: 0 is Right, 1 is Up-Right, 2 is Up and 3 is Up-Left.
+	* Back neighbour is taken from the angle -ang, so direction 0 compares twice to the right pixel.
+	*/
+	bool isLocalMaximum(const Image<uchar> &img, const int x, const int y, const double ang) const {
+		static const int frontX[] = { 1, 1, 0, -1 };
+		static const int frontY[] = { 0, -1, -1, -1 };
+		static const int backX[] = { 1, 1, 0, -1 };
+		static const int backY[] = { 0, 1, 1, 1 };
+
+		const int d = roundAngleTo(ang);
+		const uchar v = img(x, y);
+		return img(x + frontX[d], y + frontY[d]) <= v && img(x + backX[d], y + backY[d]) <= v;
+	}
+
+	// Sum the per thread histograms to histogram
+	void mergeHistograms(const vector<vector<uint> > &hists) {
+		histogram.assign(256, 0);
+		for (size_t t = 0; t < hists.size(); t++) {
+			for (int i = 0; i < 256; i++) {
+				histogram[i] += hists[t][i];
+			}
 		}
-		return img(nx, ny);
 	}
 
-	// Rounds angle to 45 deg angles
+	// Rounds angle to 45 deg angles and returns the index of the direction
 	// May change angle direction to opposite
-	double roundAngleTo(const double ang) const {
+	int roundAngleTo(const double ang) const {
 		const double a = fabs(ang);
 		if (a < M_PI / 8.0) {
 			return 0;
 		}
 		else if (a < M_PI * 3.0 / 8.0) {
-			return M_PI / 4.0;
+			return 1;
 		}
 		else if (a < M_PI * 5.0 / 8.0) {
-			return M_PI / 2.0;
+			return 2;
 		}
 		else if (a < M_PI * 7.0 / 8.0) {
-			return 3.0 * M_PI / 4.0;
+			return 3;
 		}
 		return 0;
 	}
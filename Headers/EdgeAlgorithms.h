@@ -5,7 +5,9 @@
 #include "Canny.h"
 #include "Tools.h"
 #include "Gaussian.h"
+#include "Image.h"
 #include "ArgumentParser.h"
+#include "Autotuner.h"
 
 #include <iostream>
 #include <iomanip>
@@ -32,6 +34,15 @@ private:
 	double _gaussigma;
 	int _weakThreshold;
 	int _strongThreshold;
+	int _accelerate;
+	Gaussian::Method _gaussMethod;
+	Canny::ThresholdMode _thresholdMode;
+	double _thresholdRatio;
+	double _thresholdPercentile;
+
+	// Tuned configurations, loaded at startup
+	Autotuner profile;
+	bool profileLoaded;
 
 protected:
 	CImg<uchar> input_image;
@@ -40,7 +51,7 @@ protected:
 public:
 
 	// Set default values at constructor
-	EdgeAlgorithms() : speedTestRounds(1), width(0), height(0), outputFile("output.bmp") {
+	EdgeAlgorithms() : speedTestRounds(1), width(0), height(0), outputFile("output.bmp"), profileLoaded(false) {
 
 		// Default mode is Canny
 		edgeMode = EdgeMode::CANNY;
@@ -50,13 +61,19 @@ public:
 		_gaussigma = 0.5;
 		_weakThreshold = 15;
 		_strongThreshold = 30;
+		_accelerate = 1;
+		_gaussMethod = Gaussian::FIR;
+		_thresholdMode = Canny::FIXED;
+		_thresholdRatio = 0.5;
+		_thresholdPercentile = 0.9;
 	}
 
 	//Edge mode describes the commandline arguments executable progress
 	enum EdgeMode {
 		UNDEFINED,
 		SOBEL,
-		CANNY
+		CANNY,
+		AUTOTUNE
 	} edgeMode;
 
 	// Convert mode to string, i.e. EdgeMode::SOBEL -> "Sobel"
@@ -65,7 +82,7 @@ public:
 	// set private parameters
 	EdgeMode processArguments(int argc, char **argv);
 
-	// Read Canny method arguments
+	// Read Canny method arguments, -1 if invalid
 	int readCannyParameters(int argc, char **argv);
 
 	// Print given parameters
@@ -77,6 +94,9 @@ public:
 	// save image to outputfile
 	bool saveImage() const;
 
+	// Benchmark Canny configurations and save the best ones to the profile
+	void autotune();
+
 	// return help-page
 	string helpPage() const;
 
@@ -92,21 +112,49 @@ public:
 	void perform() {
 		int time_ms = 0;
 		if (edgeMode == CANNY) {
+			int weak = _weakThreshold, strong = _strongThreshold;
 			printBox("Canny Edge detection started!");
+
+			Autotuner::Entry tuned;
+			const bool useProfile = profileLoaded && profile.select(width, height, _gaussMethod, tuned);
+			if (useProfile) {
+				cout << "Profile configuration: " << Autotuner::describe(tuned) << endl;
+			}
+			else if (profileLoaded) {
+				cout << "Profile " << profile.file() << " has no " << Autotuner::methodName(_gaussMethod) << " Gaussian entry, default configuration is used" << endl;
+			}
+			else {
+				cout << "No profile " << profile.file() << ", default configuration is used" << endl;
+			}
+
 			time_ms = (int)Tools::Measure<>::execution([&]() {
 				for (uint i = 0; i < speedTestRounds; i++) {
 					Canny canny = Canny(_gaussize, _gaussigma, _weakThreshold, _strongThreshold);
+					canny.setAccelerate(_accelerate);
+					canny.setGaussianMethod(_gaussMethod);
+					canny.setAutoThreshold(_thresholdMode, _thresholdRatio, _thresholdPercentile);
+					if (useProfile) {
+						Autotuner::apply(tuned, canny);
+					}
 					output_image = canny.perform(input_image);
+					weak = canny.weakThreshold();
+					strong = canny.strongThreshold();
 				}
 			});
+			if (_thresholdMode != Canny::FIXED) {
+				cout << "Selected thresholds: weak " << weak << ", strong " << strong << endl;
+			}
 		}
 		else if (edgeMode == SOBEL) {
 			printBox("Sobel Edge detection started!");
 			time_ms = (int)Tools::Measure<>::execution([&]() { 
-				vector<vector<double> > gradient_dir;
+				const Image<uchar> img = Image<uchar>::fromCImg(input_image);
+				Image<uchar> sobel_img;
+				Image<double> gradient_dir;
 				for (uint i = 0; i < speedTestRounds; i++) {
-					output_image = Sobel::sobelAlgorithm(input_image, gradient_dir, Sobel::EdgeStrengthMode::DIAGONAL);
+					Sobel::sobelAlgorithm(img, sobel_img, gradient_dir, Sobel::EdgeStrengthMode::DIAGONAL);
 				}
+				output_image = sobel_img.toCImg();
 			});
 		}
 		else {
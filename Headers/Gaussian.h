@@ -1,6 +1,7 @@
 #pragma once
 #include "CImg.h"
 #include "Tools.h"
+#include "Image.h"
 #include <vector>
 #include <random>
 #include <functional>
@@ -10,15 +11,38 @@
 /*
 * Class to smooth the image
 * Class uses Gaussian (Normal distribution) to smooth the image
+* - By default the image is filtered with the size x size mask. Mask is separable, so it is applied as two 1D passes.
+* - On request the image is filtered recursively (Young - van Vliet). Cost doesn't depend on sigma and the size is not used.
+*   Recursive filter is normalized and uses sigma as the standard deviation, so it doesn't give the same result as the mask.
 */
 class Gaussian
 {
-	vector<vector<double> > gaussianArr;
+public:
+
+	// Filter selection: FIR is the size x size mask, IIR the recursive filter
+	enum Method { FIR, IIR };
+
+private:
+
+	// Separable factors of the size x size mask: mask(x, y) = kernelX[x] * kernelY[y]
+	vector<double> kernelX;
+	vector<double> kernelY;
+
+	// Recursive filter coefficients, divided by b0
+	bool _recursive;
+	double _B, _b1, _b2, _b3;
 
 public:
 
 	Gaussian() { setMaskSize(5, 1.0);  }
-	Gaussian(const int s, const double sigma) { setMaskSize(s, sigma); }
+	Gaussian(const int s, const double sigma, const Method method = FIR) { setMaskSize(s, sigma, method); }
+
+	// Smallest sigma of the recursive filter. Smaller sigmas are filtered with this one.
+	// Young - van Vliet coefficients are most accurate from 2.5 upwards.
+	static double minRecursiveSigma() { return 0.5; }
+
+	// Is the image filtered with the recursive filter
+	bool recursive() const { return _recursive; }
 
 	// Normal distribution, probability density function, Norm(PDF)
 	// TODO: Calculation operations could be optimised
@@ -26,50 +50,174 @@ public:
 		return 1.0 / sqrt(2 * M_PI) / sigma * exp(-((x - mu) * (x - mu)) / (sigma * sigma));
 	}
 
-	// Create Gaussian 2d mask
+	// Create Gaussian mask
 	// TODO: use log-distribution. More accurate results and more efficient operations to computer
-	void setMaskSize(const int size, const double sigma) {
-		Tools::resize2DVector(gaussianArr, size, size);
+	void setMaskSize(const int size, const double sigma, const Method method = FIR) {
+		kernelX.assign(size, 0.0);
+		kernelY.assign(size, 1.0);
 
-		// Calculate new mask
-		for (int y = 0; y < size; y++) {
-			for (int x = 0; x < size; x++) {
+		// The mask value nX * nY uses the x distribution for both factors (symmetrical distribution),
+		// so every row of the mask is the same and the mask is kernelX[x] * 1
+		for (int x = 0; x < size; x++) {
+			const double nX = normal_pdf(x, size / 2.0, sigma);
+			const double nY = nX;
+			kernelX[x] = nX * nY;
+		}
 
-				const double nX = normal_pdf(x, size / 2.0, sigma);
-				const double nY = nX;	// symmetrical distribution
+		_recursive = (method == IIR);
+		setRecursiveCoefficients(sigma);
+	}
 
-				// 2D normal_distribution can be constructed from 1D distributions:
-				gaussianArr[y][x] = nX * nY;
-			}
-		}
+
+	// Half width of the mask, i.e. the untouched border of the filtered image
+	int radius() const {
+		return (int)std::floor(kernelX.size() / 2.0);
 	}
 
+	// Sum of the mask weights. Filtered values are limited to [gain * min, gain * max] of the input.
+	double gain() const {
+		double sumX = 0, sumY = 0;
+		for (size_t i = 0; i < kernelX.size(); i++) {
+			sumX += kernelX[i];
+			sumY += kernelY[i];
+		}
+		return sumX * sumY;
+	}
 
 	/*
-	* Apply the filterArr to the image
-	* Border areas won't be modified, so if the mask is large check boders separently.
+	* Apply the separable mask to the pixels of the area.
+	* Columns are first weighted with kernelY to a row buffer, which is then weighted with kernelX.
+	* Border areas won't be modified. out has to be allocated to the size of img.
 	*/
-	CImg<uchar> filter_image(const CImg<uchar> &img, const vector<vector<double> > &filterArr) const {
-		const int fsize = filterArr.size();
+	void filter_separable(const Image<uchar> &img, Image<uchar> &out, const Area &area) const {
+		const int fsize = (int)kernelX.size();
 		const int fs = (int)std::floor(fsize / 2.0);
+		const Area a = area.clip(Area(fs, fs, img.width() - fs, img.height() - fs));
+		if (a.empty()) return;
+
+		const int len = a.x1 - a.x0 + fsize - 1;
+		vector<double> col(len);
+
+		for (int y = a.y0; y < a.y1; y++) {
+			std::fill(col.begin(), col.end(), 0.0);
+			for (int j = 0; j < fsize; j++) {
+				const uchar *src = img.row(y + j - fs) + a.x0 - fs;
+				const double k = kernelY[j];
+				for (int n = 0; n < len; n++) {
+					col[n] += k * (double)src[n];
+				}
+			}
 
-		return Tools::filter(img, [&](int x, int y) -> int {
-			double sum = 0;
-			for (int j = -fs; j < std::ceil(fsize / 2.0); j++) {
-				for (int i = -fs; i < std::ceil(fsize / 2.0); i++) {
-					if (x + i >= img.width() || y + j >= img.height() || x + i < 0 || y + j < 0) continue;
-					sum += filterArr[j + fs][i + fs] * (double)img(x + i, y + j);
+			uchar *dst = out.row(y);
+			for (int x = a.x0; x < a.x1; x++) {
+				const double *c = &col[x - a.x0];
+				double sum = 0;
+				for (int i = 0; i < fsize; i++) {
+					sum += kernelX[i] * c[i];
 				}
+				dst[x] = (uchar)(int)sum;
 			}
-			return (int)sum;
-		}, fs);
+		}
 	}
 
 	/*
-	* Smooth the image with Gaussian mask
+	* Recursive Gaussian (Young - van Vliet), normalized to gain 1.
+	* Rows are filtered forward and backward one at a time. Columns are filtered by
+	* running the same recursion over whole rows, so the memory is always read along the rows.
+	* Borders are extended with the edge pixels.
 	*/
-	CImg<uchar> filter_image(const CImg<uchar> &img) const {
-		return filter_image(img, gaussianArr);
+	void filter_recursive(const Image<uchar> &img, Image<uchar> &out) const {
+		const int w = img.width();
+		const int h = img.height();
+		out.resize(w, h);
+		if (w == 0 || h == 0) return;
+
+		Image<float> tmp(w, h);
+		const float B = (float)_B, b1 = (float)_b1, b2 = (float)_b2, b3 = (float)_b3;
+
+		// Horizontal
+		for (int y = 0; y < h; y++) {
+			const uchar *src = img.row(y);
+			float *t = tmp.row(y);
+
+			float p1 = src[0], p2 = src[0], p3 = src[0];
+			for (int x = 0; x < w; x++) {
+				const float v = B * src[x] + b1 * p1 + b2 * p2 + b3 * p3;
+				t[x] = v;
+				p3 = p2; p2 = p1; p1 = v;
+			}
+
+			p1 = p2 = p3 = t[w - 1];
+			for (int x = w - 1; x >= 0; x--) {
+				const float v = B * t[x] + b1 * p1 + b2 * p2 + b3 * p3;
+				t[x] = v;
+				p3 = p2; p2 = p1; p1 = v;
+			}
+		}
+
+		// Vertical, forward
+		for (int y = 1; y < h; y++) {
+			float *t = tmp.row(y);
+			const float *p1 = tmp.row(y - 1);
+			const float *p2 = tmp.row(max(y - 2, 0));
+			const float *p3 = tmp.row(max(y - 3, 0));
+			for (int x = 0; x < w; x++) {
+				t[x] = B * t[x] + b1 * p1[x] + b2 * p2[x] + b3 * p3[x];
+			}
+		}
+
+		// Vertical, backward
+		for (int y = h - 2; y >= 0; y--) {
+			float *t = tmp.row(y);
+			const float *p1 = tmp.row(y + 1);
+			const float *p2 = tmp.row(min(y + 2, h - 1));
+			const float *p3 = tmp.row(min(y + 3, h - 1));
+			for (int x = 0; x < w; x++) {
+				t[x] = B * t[x] + b1 * p1[x] + b2 * p2[x] + b3 * p3[x];
+			}
+		}
+
+		for (int y = 0; y < h; y++) {
+			const float *t = tmp.row(y);
+			uchar *dst = out.row(y);
+			for (int x = 0; x < w; x++) {
+				dst[x] = (uchar)min(max((int)(t[x] + 0.5f), 0), 255);
+			}
+		}
 	}
-};
 
+	/*
+	* Smooth the image with Gaussian mask or recursive filter
+	*/
+	void filter_image(const Image<uchar> &img, Image<uchar> &out) const {
+		if (_recursive) {
+			filter_recursive(img, out);
+			return;
+		}
+		out.resize(img.width(), img.height());
+		filter_separable(img, out, img.area());
+	}
+
+	/*
+	* Smooth only the given area of the image with the mask. out has to be allocated to the size of img.
+	* Recursive filter depends on the whole image, so it can't be limited to an area.
+	*/
+	void filter_image(const Image<uchar> &img, Image<uchar> &out, const Area &area) const {
+		filter_separable(img, out, area);
+	}
+
+private:
+
+	// Young - van Vliet (1995) recursive Gaussian coefficients
+	void setRecursiveCoefficients(const double sigma) {
+		const double s = max(sigma, minRecursiveSigma());
+		const double q = (s >= 2.5) ? 0.98711 * s - 0.96330 : 3.97156 - 4.14554 * sqrt(1.0 - 0.26891 * s);
+		const double q2 = q * q, q3 = q2 * q;
+
+		const double b0 = 1.57825 + 2.44413 * q + 1.4281 * q2 + 0.422205 * q3;
+		_b1 = (2.44413 * q + 2.85619 * q2 + 1.26661 * q3) / b0;
+		_b2 = -(1.4281 * q2 + 1.26661 * q3) / b0;
+		_b3 = (0.422205 * q3) / b0;
+		_B = 1.0 - (_b1 + _b2 + _b3);
+	}
+};
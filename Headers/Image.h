@@ -0,0 +1,251 @@
+#pragma once
+#include "CImg.h"
+#include "Tools.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <utility>
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+/*
+* Area struct
+* Rectangle [x0, x1) x [y0, y1) in pixel coordinates
+*/
+struct Area
+{
+	int x0, y0, x1, y1;
+
+	Area() : x0(0), y0(0), x1(0), y1(0) {}
+	Area(const int ax0, const int ay0, const int ax1, const int ay1) : x0(ax0), y0(ay0), x1(ax1), y1(ay1) {}
+
+	bool empty() const { return x0 >= x1 || y0 >= y1; }
+
+	// Grow the area by n pixels to every direction
+	Area expand(const int n) const { return Area(x0 - n, y0 - n, x1 + n, y1 + n); }
+
+	// Intersection of two areas
+	Area clip(const Area &a) const {
+		return Area(std::max(x0, a.x0), std::max(y0, a.y0), std::min(x1, a.x1), std::min(y1, a.y1));
+	}
+
+	// Is the area a inside of this area
+	bool contains(const Area &a) const { return a.x0 >= x0 && a.y0 >= y0 && a.x1 <= x1 && a.y1 <= y1; }
+};
+
+
+/*
+* ImageView class
+* Non-owning window to a 2D plane. Rows are 'stride' elements apart,
+* so a sub-view shares the memory of its parent without any copying.
+*/
+template<typename T>
+class ImageView
+{
+protected:
+	T *_data;
+	int _width;
+	int _height;
+	int _stride;
+
+public:
+
+	ImageView() : _data(0), _width(0), _height(0), _stride(0) {}
+	ImageView(T *data, const int w, const int h, const int stride) : _data(data), _width(w), _height(h), _stride(stride) {}
+
+	int width() const { return _width; }
+	int height() const { return _height; }
+
+	// Distance between two rows in elements (not in bytes)
+	int stride() const { return _stride; }
+
+	bool empty() const { return _data == 0 || _width == 0 || _height == 0; }
+
+	// Area of the whole plane
+	Area area() const { return Area(0, 0, _width, _height); }
+
+	// Pointer to the first pixel of the row y
+	T *row(const int y) { return _data + (size_t)y * _stride; }
+	const T *row(const int y) const { return _data + (size_t)y * _stride; }
+
+	T &operator()(const int x, const int y) { return row(y)[x]; }
+	const T &operator()(const int x, const int y) const { return row(y)[x]; }
+
+	// Sub-view of the area [x, x + w) x [y, y + h). No bounds checking.
+	ImageView<T> view(const int x, const int y, const int w, const int h) {
+		return ImageView<T>(row(y) + x, w, h, _stride);
+	}
+
+	// Read-only sub-view of the area [x, x + w) x [y, y + h). No bounds checking.
+	ImageView<const T> view(const int x, const int y, const int w, const int h) const {
+		return ImageView<const T>(row(y) + x, w, h, _stride);
+	}
+
+	// Set every pixel of the view to value
+	void fill(const T &value) {
+		for (int y = 0; y < _height; y++) {
+			T *r = row(y);
+			for (int x = 0; x < _width; x++) {
+				r[x] = value;
+			}
+		}
+	}
+
+	// Set the pixels closer than n to the edges of the view to value
+	void fillBorder(const int n, const T &value) {
+		const int nx = std::min(n, _width);
+		const int ny = std::min(n, _height);
+		for (int y = 0; y < _height; y++) {
+			T *r = row(y);
+			if (y < ny || y >= _height - ny) {
+				for (int x = 0; x < _width; x++) r[x] = value;
+			}
+			else {
+				for (int x = 0; x < nx; x++) r[x] = value;
+				for (int x = _width - nx; x < _width; x++) r[x] = value;
+			}
+		}
+	}
+};
+
+
+/*
+* Image class
+* Flat 2D plane, which owns its memory. Every row starts from 64-byte boundary
+* and the stride is padded, so rows can be processed with wide loads and
+* without cache line splits. CImg is used only to load and save the images.
+*/
+template<typename T>
+class Image : public ImageView<T>
+{
+	T *_buffer;
+
+public:
+
+	// Row alignment in bytes (cache line)
+	static const int ALIGNMENT = 64;
+
+	Image() : _buffer(0) {}
+	Image(const int w, const int h) : _buffer(0) { resize(w, h); }
+
+	Image(const Image<T> &other) : _buffer(0) {
+		resize(other.width(), other.height());
+		for (int y = 0; y < this->_height; y++) {
+			memcpy(this->row(y), other.row(y), this->_width * sizeof(T));
+		}
+	}
+
+	Image(Image<T> &&other) noexcept : ImageView<T>(other), _buffer(other._buffer) {
+		other._buffer = 0;
+		other._data = 0;
+		other._width = other._height = other._stride = 0;
+	}
+
+	Image<T> &operator=(Image<T> other) {
+		swap(other);
+		return *this;
+	}
+
+	~Image() { release(); }
+
+	void swap(Image<T> &other) noexcept {
+		std::swap(this->_data, other._data);
+		std::swap(this->_width, other._width);
+		std::swap(this->_height, other._height);
+		std::swap(this->_stride, other._stride);
+		std::swap(_buffer, other._buffer);
+	}
+
+	/*
+	* Allocate w x h plane and set all pixels (including padding) to zero.
+	* Old memory is reused, if the dimensions don't change.
+	*/
+	void resize(const int w, const int h) {
+		allocate(w, h);
+		if (_buffer) {
+			memset(_buffer, 0, (size_t)this->_stride * this->_height * sizeof(T));
+		}
+	}
+
+	/*
+	* Allocate w x h plane without clearing it, the pixel values are undefined.
+	* Used for planes, which are written before they are read.
+	*/
+	void allocate(const int w, const int h) {
+		if (w != this->_width || h != this->_height) {
+			release();
+			const int stride = paddedStride(w);
+			const size_t bytes = (size_t)stride * h * sizeof(T);
+			_buffer = (T*)alignedAlloc(bytes > 0 ? bytes : ALIGNMENT);
+			if (!_buffer) throw std::bad_alloc();
+
+			this->_data = _buffer;
+			this->_width = w;
+			this->_height = h;
+			this->_stride = stride;
+		}
+	}
+
+	// Copy the first channel of CImg to a new plane
+	static Image<T> fromCImg(const CImg<T> &img) {
+		Image<T> out;
+		out.allocate(img.width(), img.height());
+		for (int y = 0; y < out.height(); y++) {
+			T *r = out.row(y);
+			for (int x = 0; x < out.width(); x++) {
+				r[x] = img(x, y);
+			}
+		}
+		return out;
+	}
+
+	// Copy the plane to CImg for saving and displaying
+	CImg<T> toCImg() const {
+		CImg<T> out(this->_width, this->_height);
+		for (int y = 0; y < this->_height; y++) {
+			const T *r = this->row(y);
+			for (int x = 0; x < this->_width; x++) {
+				out(x, y) = r[x];
+			}
+		}
+		return out;
+	}
+
+private:
+
+	// Round the row length up to full cache lines. Strides, which are multiple of 4KB,
+	// are avoided as those make vertical neighbours compete of the same cache sets.
+	static int paddedStride(const int w) {
+		const int perLine = ALIGNMENT / sizeof(T);
+		int stride = ((w + perLine - 1) / perLine) * perLine;
+		if (stride > 0 && (stride * sizeof(T)) % 4096 == 0) {
+			stride += perLine;
+		}
+		return stride;
+	}
+
+	static void *alignedAlloc(const size_t bytes) {
+#ifdef _WIN32
+		return _aligned_malloc(bytes, ALIGNMENT);
+#else
+		void *p = 0;
+		return posix_memalign(&p, ALIGNMENT, bytes) == 0 ? p : 0;
+#endif
+	}
+
+	void release() {
+		if (_buffer) {
+#ifdef _WIN32
+			_aligned_free(_buffer);
+#else
+			free(_buffer);
+#endif
+		}
+		_buffer = 0;
+		this->_data = 0;
+		this->_width = this->_height = this->_stride = 0;
+	}
+};
@@ -1,6 +1,7 @@
 #pragma once
 #include "CImg.h"
 #include "Tools.h"
+#include "Image.h"
 #include <vector>
 
 /*
@@ -20,9 +21,13 @@ public:
 	// Possible Edge strength modes, Diagonal or Block wise
 	enum EdgeStrengthMode { UNDEF, DIAGONAL, BLOCK };
 
-	// Perform Sobel algorithm to the image
+	// Perform Sobel algorithm to the image, edge strengths are written to out
 	// function creates gradient_dir, which includes all gradient directions in radians. [i.e RIGHT = 0 rad, UP = PI/4 rads]
 	// EdgeStrengthMode is by default DIAGONAL (optimal), but to fast up calculations BLOCK-mode can be used [approximates the results]
-	static CImg<uchar> sobelAlgorithm(const CImg<uchar> &image, vector<vector<double> > &gradient_dir, const EdgeStrengthMode strMode = EdgeStrengthMode::DIAGONAL);
+	static void sobelAlgorithm(const Image<uchar> &image, Image<uchar> &out, Image<double> &gradient_dir, const EdgeStrengthMode strMode = EdgeStrengthMode::DIAGONAL);
+
+	// Perform Sobel algorithm only to the pixels of the area
+	// out and gradient_dir have to be allocated to the size of the image
+	static void sobelAlgorithm(const Image<uchar> &image, Image<uchar> &out, Image<double> &gradient_dir, const Area &area, const EdgeStrengthMode strMode = EdgeStrengthMode::DIAGONAL);
 
 };
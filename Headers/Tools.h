@@ -5,6 +5,14 @@
 #include <vector>
 #include <chrono>
 #include <functional>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <cstdint>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 
 // All other files includes namespaces here
 using namespace std;
@@ -22,38 +30,51 @@ class Tools
 {
 public:
 
-	// Filter to apply function to every cell in 2D array
-	static CImg<uchar> filter(const CImg<uchar> &img, std::function<int(int, int)> func, const int padding = 1) {
-		CImg<uchar> fimg(img.width(), img.height());
-		for (int y = padding; y < img.height() - padding; y++) {
-			for (int x = padding; x < img.width() - padding; x++) {
-				fimg(x, y) = func(x, y);
-			}
-		}
-		return fimg;
+	// Number of hardware threads, at least 1
+	static int hardwareThreads() {
+		const unsigned int n = std::thread::hardware_concurrency();
+		return n ? (int)n : 1;
 	}
 
-	// Apply function to every pixel in the image
-	static void checkPixels(const CImg<uchar> &img, std::function<void(int, int)> func, const int padding = 1) {
-		for (int y = padding; y < img.height() - padding; y++) {
-			for (int x = padding; x < img.width() - padding; x++) {
-				func(x, y);
-			}
-		}
+	// Index of the lowest set bit. x can't be zero.
+	static inline int lowestBit(const uint64_t x) {
+#ifdef _MSC_VER
+		unsigned long i;
+		if (_BitScanForward(&i, (unsigned long)x)) return (int)i;
+		_BitScanForward(&i, (unsigned long)(x >> 32));
+		return (int)i + 32;
+#else
+		return __builtin_ctzll(x);
+#endif
 	}
 
-	// Resize 2D array
-	template<typename T>
-	static void resize2DVector(std::vector<std::vector<T> > &v, const int w, const int h) {
+	/*
+	* Process rows [y0, y1) in bands of bandHeight rows with the given number of threads.
+	* Threads take the next free band until all are done.
+	* func(bandStart, bandEnd, threadIndex), threadIndex is between 0 - (threads - 1)
+	*/
+	static void parallelRows(const int y0, const int y1, const int threads, const std::function<void(int, int, int)> &func, const int bandHeight = 64) {
+		if (threads <= 1 || y1 - y0 <= bandHeight) {
+			if (y0 < y1) func(y0, y1, 0);
+			return;
+		}
+
+		std::atomic<int> next(y0);
+		auto worker = [&](const int t) {
+			for (;;) {
+				const int b = next.fetch_add(bandHeight);
+				if (b >= y1) break;
+				func(b, std::min(b + bandHeight, y1), t);
+			}
+		};
 
-		// Allocate and update 2D array
-		// reserve will allocate the memory but will not resize your vector, which will have a logical size the same as it was before.
-		// resize will modify the size of your vector and will fill any space with objects in their default state
-		v.reserve(h);
-		v.resize(h);
-		for (int k = 0; k < h; ++k) {
-			v[k].reserve(w);
-			v[k].resize(w);
+		std::vector<std::thread> pool;
+		for (int t = 1; t < threads; t++) {
+			pool.push_back(std::thread(worker, t));
+		}
+		worker(0);
+		for (size_t t = 0; t < pool.size(); t++) {
+			pool[t].join();
 		}
 	}
 
@@ -0,0 +1,175 @@
+#include "Autotuner.h"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <random>
+
+
+void Autotuner::tune(const int gaussize, const double gaussigma, const Gaussian::Method gaussMethod, const int weakThreshold, const int strongThreshold) {
+	const int sizes[][2] = { { 512, 512 }, { 1024, 1024 }, { 2048, 2048 } };
+
+	// Candidate values. Gaussian filter changes the output, so it is not tuned.
+	vector<int> threadCounts;
+	const int hw = Tools::hardwareThreads();
+	for (int t = 1; t < hw; t *= 2) threadCounts.push_back(t);
+	threadCounts.push_back(hw);
+
+	const int bandHeights[] = { 8, 16, 32, 64, 128, 256 };
+
+	// Old entries of this Gaussian method are replaced
+	entries.erase(std::remove_if(entries.begin(), entries.end(), [&](const Entry &e) {
+		return e.gaussMethod == gaussMethod;
+	}), entries.end());
+
+	Canny base = Canny(gaussize, gaussigma, weakThreshold, strongThreshold);
+	base.setGaussianMethod(gaussMethod);
+
+	for (const auto &size : sizes) {
+		const Image<uchar> img = testImage(size[0], size[1]);
+		cout << "Tuning " << size[0] << "x" << size[1] << endl;
+
+		Entry best = { size[0], size[1], gaussMethod, 64, hw, 0.0 };
+		best.time_ms = measure(img, best, base);
+
+		// Parameters are tuned one at a time, starting from the one with the largest effect
+		for (size_t i = 0; i < threadCounts.size(); i++) {
+			Entry e = best;
+			e.threads = threadCounts[i];
+			e.time_ms = measure(img, e, base);
+			if (e.time_ms < best.time_ms) best = e;
+		}
+
+		// One thread processes the rows as a whole, so the band height has no effect
+		for (size_t i = 0; best.threads > 1 && i < sizeof(bandHeights) / sizeof(bandHeights[0]); i++) {
+			Entry e = best;
+			e.bandHeight = bandHeights[i];
+			e.time_ms = measure(img, e, base);
+			if (e.time_ms < best.time_ms) best = e;
+		}
+
+		cout << "  " << describe(best) << ": " << best.time_ms << " ms" << endl;
+		entries.push_back(best);
+	}
+}
+
+
+bool Autotuner::load() {
+	std::ifstream in(profileFile.c_str());
+	if (!in) return false;
+
+	entries.clear();
+	string line;
+	while (std::getline(in, line)) {
+		if (line.empty() || line[0] == '#') continue;
+
+		std::istringstream ss(line);
+		Entry e;
+		string method;
+		if (!(ss >> e.width >> e.height >> method >> e.bandHeight >> e.threads >> e.time_ms) || (method != methodName(Gaussian::FIR) && method != methodName(Gaussian::IIR))) {
+			std::cerr << "PROFILE ERROR: invalid line in " << profileFile << ": " << line << endl;
+			continue;
+		}
+		e.gaussMethod = (method == methodName(Gaussian::IIR)) ? Gaussian::IIR : Gaussian::FIR;
+		entries.push_back(e);
+	}
+	return true;
+}
+
+
+bool Autotuner::save() const {
+	std::ofstream out(profileFile.c_str());
+	if (!out) {
+		std::cerr << "Error writting the file:" << profileFile << std::endl;
+		return false;
+	}
+
+	out << "# EdgeDetection autotune profile\n"
+		<< "# width height gaussian band_height threads time_ms\n";
+	for (size_t i = 0; i < entries.size(); i++) {
+		const Entry &e = entries[i];
+		out << e.width << " " << e.height << " " << methodName(e.gaussMethod) << " "
+			<< e.bandHeight << " " << e.threads << " " << e.time_ms << "\n";
+	}
+	return true;
+}
+
+
+bool Autotuner::select(const int w, const int h, const Gaussian::Method gaussMethod, Entry &entry) const {
+	bool found = false;
+	double bestDistance = 0;
+	for (size_t i = 0; i < entries.size(); i++) {
+		const Entry &e = entries[i];
+		if (e.gaussMethod != gaussMethod) continue;
+
+		// Sizes are compared by the ratio of the pixel counts
+		const double distance = fabs(log((double)e.width * e.height / max((double)w * h, 1.0)));
+		if (!found || distance < bestDistance) {
+			bestDistance = distance;
+			entry = e;
+			found = true;
+		}
+	}
+	return found;
+}
+
+
+void Autotuner::apply(const Entry &entry, Canny &canny) {
+	canny.setThreads(entry.threads);
+	canny.setBandHeight(entry.bandHeight);
+}
+
+
+string Autotuner::describe(const Entry &entry) {
+	std::ostringstream ss;
+	ss << methodName(entry.gaussMethod) << " Gaussian, band " << entry.bandHeight << ", threads " << entry.threads;
+	return ss.str();
+}
+
+
+string Autotuner::methodName(const Gaussian::Method method) {
+	return (method == Gaussian::IIR) ? "recursive" : "mask";
+}
+
+
+Image<uchar> Autotuner::testImage(const int w, const int h) {
+	Image<uchar> img(w, h);
+	img.fill(235);
+
+	std::mt19937 rng(1);
+	std::uniform_int_distribution<int> ink(10, 80), glyph(8, 30), gap(4, 20), noise(-2, 2);
+
+	// Text lines
+	for (int y0 = h / 16; y0 + 30 < h - h / 16; y0 += 70) {
+		int x = w / 16;
+		while (x + 30 < w - w / 16) {
+			const int cw = glyph(rng);
+			const int ch = 20 + glyph(rng) % 10;
+			img.view(x, y0, cw, ch).fill((uchar)ink(rng));
+			x += cw + gap(rng);
+		}
+	}
+
+	for (int y = 0; y < h; y++) {
+		uchar *r = img.row(y);
+		for (int x = 0; x < w; x++) {
+			r[x] = (uchar)min(max(r[x] + noise(rng), 0), 255);
+		}
+	}
+	return img;
+}
+
+
+double Autotuner::measure(const Image<uchar> &img, const Entry &config, const Canny &base, const int rounds) {
+	double best = -1;
+	for (int i = 0; i < rounds; i++) {
+		Canny canny = base;
+		apply(config, canny);
+
+		const double t = (double)Tools::Measure<std::chrono::microseconds>::execution([&]() {
+			canny.perform(img);
+		}) / 1000.0;
+		if (best < 0 || t < best) best = t;
+	}
+	return best;
+}
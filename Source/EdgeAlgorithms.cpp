@@ -30,6 +30,7 @@ bool EdgeAlgorithms::loadImage() {
 string EdgeAlgorithms::edgeModeToString(const EdgeMode e) const {
 	if (e == EdgeMode::CANNY) return "Canny";
 	if (e == EdgeMode::SOBEL) return "Sobel";
+	if (e == EdgeMode::AUTOTUNE) return "Autotune";
 	return "Unknown";
 }
 
@@ -61,14 +62,18 @@ void EdgeAlgorithms::printInfo() const {
 			 << "** CANNY PARAMETERS:   " << endl
 			 << "* Gaussian matrix size " << _gaussize << endl
 			 << "* Gaussian sigma:      " << _gaussigma << endl
+			 << "* Gaussian filter:     " << (_gaussMethod == Gaussian::IIR ? "recursive" : "mask") << endl
 			 << "* Weak threshold:      " << _weakThreshold << endl
 			 << "* Strong threshold:    " << _strongThreshold << endl
+			 << "* Auto threshold:      " << (_thresholdMode == Canny::OTSU ? "Otsu" : _thresholdMode == Canny::PERCENTILE ? "percentile " + to_string((int)(_thresholdPercentile * 100 + 0.5)) + "%" : "off") << endl
+			 << "* Acceleration:        " << (_accelerate > 1 ? to_string(_accelerate) + "x" : "off") << endl
 		<< "********************************" << endl << endl;
 	}
 }
 
 /*
 * Parse Canny edgedetection commandline parameters
+* Returns the number of read arguments, or -1 if some of them is invalid.
 */
 int EdgeAlgorithms::readCannyParameters(int argc, char **argv) {
 	int arguments = 0;
@@ -78,6 +83,59 @@ int EdgeAlgorithms::readCannyParameters(int argc, char **argv) {
 	arguments += AP::readNumberArgument<double>(argv, argv + argc, "--sigma", _gaussigma);
 	arguments += AP::readNumberArgument<int>(argv, argv + argc, "--wt", _weakThreshold);
 	arguments += AP::readNumberArgument<int>(argv, argv + argc, "--st", _strongThreshold);
+	arguments += AP::readNumberArgument<int>(argv, argv + argc, "--accelerate", _accelerate);
+
+	arguments += AP::readNumberArgument<double>(argv, argv + argc, "--ratio", _thresholdRatio);
+	arguments += AP::readNumberArgument<double>(argv, argv + argc, "--percentile", _thresholdPercentile);
+
+	if (AP::cmdOptionExists(argv, argv + argc, "--auto-threshold")) {
+		const char *opt = AP::getCmdOption(argv, argv + argc, "--auto-threshold");
+		const string mode = opt ? opt : "";
+		if (mode == "otsu") {
+			_thresholdMode = Canny::OTSU;
+		}
+		else if (mode == "percentile") {
+			_thresholdMode = Canny::PERCENTILE;
+		}
+		else {
+			cout << "Invalid automatic threshold!\nOptions are: otsu, percentile" << endl;
+			return -1;
+		}
+		arguments += 2;
+	}
+
+	if (AP::cmdOptionExists(argv, argv + argc, "--gaussmethod")) {
+		const char *opt = AP::getCmdOption(argv, argv + argc, "--gaussmethod");
+		const string method = opt ? opt : "";
+		if (method == "mask") {
+			_gaussMethod = Gaussian::FIR;
+		}
+		else if (method == "recursive") {
+			_gaussMethod = Gaussian::IIR;
+		}
+		else {
+			cout << "Invalid Gaussian method!\nOptions are: mask, recursive" << endl;
+			return -1;
+		}
+		arguments += 2;
+	}
+
+	if (_gaussMethod == Gaussian::IIR && _gaussigma < Gaussian::minRecursiveSigma()) {
+		cout << "Invalid Gaussian sigma!\nRecursive Gaussian needs sigma " << Gaussian::minRecursiveSigma() << " or over" << endl;
+		return -1;
+	}
+	if (_accelerate != 1 && _accelerate != 2 && _accelerate != 4) {
+		cout << "Invalid acceleration!\nOptions are: 1 (off), 2, 4" << endl;
+		return -1;
+	}
+	if (_accelerate > 1 && _thresholdMode != Canny::FIXED) {
+		cout << "Invalid acceleration!\n--accelerate needs fixed thresholds, so it can't be used with --auto-threshold" << endl;
+		return -1;
+	}
+	if (_thresholdRatio <= 0.0 || _thresholdRatio > 1.0 || _thresholdPercentile <= 0.0 || _thresholdPercentile > 1.0) {
+		cout << "Invalid automatic threshold!\nGive ratio and percentile between 0 - 1. i.e. --ratio 0.4 --percentile 0.8" << endl;
+		return -1;
+	}
 
 	return arguments;
 }
@@ -93,6 +151,25 @@ EdgeAlgorithms::EdgeMode EdgeAlgorithms::processArguments(int argc, char **argv)
 		return EdgeMode::UNDEFINED;
 	}
 
+	if (ArgumentParser::cmdOptionExists(argv, argv + argc, "--profile")) {
+		const char *file = ArgumentParser::getCmdOption(argv, argv + argc, "--profile");
+		if (!file) {
+			cout << "Invalid profile!\nGive profile file. i.e. --profile edge_profile.txt" << endl;
+			return EdgeMode::UNDEFINED;
+		}
+		profile = Autotuner(file);
+		arguments += 2;
+	}
+
+	// Autotune uses Canny parameters and doesn't need an input file
+	if (ArgumentParser::cmdOptionExists(argv, argv + argc, "--autotune")) {
+		if (readCannyParameters(argc, argv) < 0) {
+			return EdgeMode::UNDEFINED;
+		}
+		edgeMode = EdgeMode::AUTOTUNE;
+		return edgeMode;
+	}
+
 	if (ArgumentParser::cmdOptionExists(argv, argv + argc, "--mode")) {
 		// Read mode and change it to lower case
 		string mode = ArgumentParser::getCmdOption(argv, argv + argc, "--mode");
@@ -100,7 +177,11 @@ EdgeAlgorithms::EdgeMode EdgeAlgorithms::processArguments(int argc, char **argv)
 
 		if (mode == "canny") {
 			edgeMode = EdgeMode::CANNY;
-			arguments += readCannyParameters(argc, argv);
+			const int cannyArguments = readCannyParameters(argc, argv);
+			if (cannyArguments < 0) {
+				return EdgeMode::UNDEFINED;
+			}
+			arguments += cannyArguments;
 		}
 		else if (mode == "sobel") {
 			edgeMode = EdgeMode::SOBEL;
@@ -139,9 +220,25 @@ EdgeAlgorithms::EdgeMode EdgeAlgorithms::processArguments(int argc, char **argv)
 	}
 	inputFile = argv[argc - 1];
 
+	if (edgeMode == EdgeMode::CANNY) {
+		profileLoaded = profile.load();
+	}
+
 	return edgeMode;
 }
 
+void EdgeAlgorithms::autotune() {
+	printBox("Autotune started!");
+
+	// Entries of other Gaussian parameters are kept
+	profile.load();
+	profile.tune(_gaussize, _gaussigma, _gaussMethod, _weakThreshold, _strongThreshold);
+
+	if (profile.save()) {
+		cout << endl << "Profile saved to " << profile.file() << endl;
+	}
+}
+
 string EdgeAlgorithms::helpPage() const {
 	const string help = ""
 		"Program usage: ./program <parameters> input_file\n\n"
@@ -152,13 +249,26 @@ string EdgeAlgorithms::helpPage() const {
 		"(Optional) Arguments\n"
 		" --mode : Which algorithm are we using? Options are: Sobel, Canny\n"
 		" --speedtest n: Run funktion n[1-1000] times and show cpu time\n"
-		" --output : Output file name, i.e. output.bmp\n\n"
+		" --output : Output file name, i.e. output.bmp\n"
+		" --profile : Autotune profile file, i.e. edge_profile.txt (default)\n"
+		" --autotune : Benchmark Canny configurations with the given Canny parameters and save the best ones to the profile.\n"
+		"              Only band height and thread count are tuned, so the profile doesn't change the edges.\n"
+		"              Canny runs use the entry of their Gaussian method, which is closest to the image size.\n\n"
 
 		"* Canny Mode's (optional) parameters\n"
 		" --gaussize : Gaussian matrix size[1 - img_size], i.e. 5\n"
 		" --sigma : Gassian sigma[0.001 - 10.0], i.e. 1.5\n"
+		" --gaussmethod : Gaussian filter. Options are: mask (default), recursive\n"
+		"   Recursive filter is faster with large sigmas (2.5 and over) and needs sigma 0.5 or over.\n"
+		"   It ignores --gaussize, smooths with the true standard deviation sigma and keeps\n"
+		"   the brightness, so its edges differ from the mask with the same sigma.\n"
 		" --wt : Weak threshold[0 - 255], i.e. 10\n"
-		" --st : Strong threshold[0 - 255], i.e. 20\n\n"
+		" --st : Strong threshold[0 - 255], i.e. 20\n"
+		" --accelerate : Coarse-to-fine detection, downsampling factor[1, 2, 4], i.e. 4\n"
+		" --auto-threshold : Select thresholds from the image, --wt and --st are ignored. Options are: otsu, percentile\n"
+		"   Can't be combined with --accelerate, which selects the regions with the strong threshold.\n"
+		" --ratio : Weak:strong ratio of --auto-threshold[0 - 1], i.e. 0.5\n"
+		" --percentile : Strong threshold percentile of --auto-threshold percentile[0 - 1], i.e. 0.9\n\n"
 
 		"(Other) Arguments\n"
 		" --help : Help page\n\n"
@@ -172,6 +282,10 @@ string EdgeAlgorithms::helpPage() const {
 		"./program --mode canny --sigma 2.0 --wt 10 --st 20 input.bmp\n"
 		"./program --mode canny --speedtest 5 --output test.bmp input.bmp\n"
 		"./program --mode canny --gaussize 5 --sigma 2.0 --wt 10 --st 20 input.bmp\n"
+		"./program --mode canny --accelerate 4 input.bmp\n"
+		"./program --mode canny --sigma 3.0 --gaussmethod recursive input.bmp\n"
+		"./program --mode canny --auto-threshold otsu --ratio 0.4 input.bmp\n"
+		"./program --autotune --gaussize 5 --sigma 0.5\n"
 		"./program --speedtest 10 --output alltest.bmp --mode canny --gaussize 5 --sigma 2.0 --wt 10 --st 20 input.bmp\n\n";
 	return help;
 }
@@ -22,43 +22,51 @@ int const Sobel::GY[4][4] = {
 };
 
 
-CImg<uchar> Sobel::sobelAlgorithm(const CImg<uchar> &image, vector<vector<double> > &gradient_dir, const EdgeStrengthMode strMode) {
+void Sobel::sobelAlgorithm(const Image<uchar> &image, Image<uchar> &out, Image<double> &gradient_dir, const EdgeStrengthMode strMode) {
 	const int width = image.width();
 	const int height = image.height();
 
-	Tools::resize2DVector<double>(gradient_dir, width + 1, height + 1);
+	out.resize(width, height);
+	gradient_dir.resize(width, height);
+
+	sobelAlgorithm(image, out, gradient_dir, image.area(), strMode);
+}
+
+
+void Sobel::sobelAlgorithm(const Image<uchar> &image, Image<uchar> &out, Image<double> &gradient_dir, const Area &area, const EdgeStrengthMode strMode) {
+	const Area a = area.clip(Area(1, 1, image.width() - 1, image.height() - 1));
 
 	// Edge detection using Sobel Algorithm
-	return Tools::filter(image, [&](int x, int y) -> int {
-		int sumX = 0, sumY = 0;
+	// Last row and column of GX and GY are zeros, so only 3x3 area is used
+	for (int y = a.y0; y < a.y1; y++) {
+		const uchar *r0 = image.row(y - 1);
+		const uchar *r1 = image.row(y);
+		const uchar *r2 = image.row(y + 1);
+		uchar *dst = out.row(y);
+		double *dir = gradient_dir.row(y);
 
-		// Convolution for X
-		for (int j = -1; j<3; j++) {
-			for (int i = -1; i<3; i++) {
-				if (x + i >= width || y + j >= height || x + i < 0 || y + i < 0) continue;
-				sumX = sumX + GX[j + 1][i + 1] * (int)image(x + i, y + j);
-			}
-		}
-		// Convolution for Y
-		for (int j = -1; j< 3; j++) {
-			for (int i = -1; i< 3; i++) {
-				if (x + i >= width || y + j >= height || x + i < 0 || y + i < 0) continue;
-				sumY = sumY + GY[j + 1][i + 1] * (int)image(x + i, y + j);
+		for (int x = a.x0; x < a.x1; x++) {
+			int sumX = 0, sumY = 0;
+
+			// Convolution for X and Y
+			for (int i = -1; i < 2; i++) {
+				sumX += GX[0][i + 1] * (int)r0[x + i] + GX[1][i + 1] * (int)r1[x + i] + GX[2][i + 1] * (int)r2[x + i];
+				sumY += GY[0][i + 1] * (int)r0[x + i] + GY[1][i + 1] * (int)r1[x + i] + GY[2][i + 1] * (int)r2[x + i];
 			}
-		}
 
-		// Edge strength
-		int sum;
-		if (strMode == EdgeStrengthMode::DIAGONAL) {
-			sum = (int)(sqrt(pow((double)sumX, 2) + pow((double)sumY, 2)) + 0.5);
-		}
-		else { 
-			sum = sumX + sumY; // Approximate distance
-		}
+			// Edge strength
+			int sum;
+			if (strMode == EdgeStrengthMode::DIAGONAL) {
+				sum = (int)(sqrt((double)(sumX * sumX + sumY * sumY)) + 0.5);
+			}
+			else {
+				sum = sumX + sumY; // Approximate distance
+			}
 
-		// Gradient direction in radians
-		gradient_dir[y][x] = (sumX == 0) ? MY_PI : atan2(sumY, sumX);
+			// Gradient direction in radians
+			dir[x] = (sumX == 0) ? MY_PI : atan2(sumY, sumX);
 
-		return min(max(sum, 0), 255);
-	}, 1);
-}
\ No newline at end of file
+			dst[x] = (uchar)min(max(sum, 0), 255);
+		}
+	}
+}
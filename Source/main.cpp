@@ -5,7 +5,11 @@ int main(int argc, char **argv)
 	EdgeAlgorithms program = EdgeAlgorithms();
 
 	try {
-		if (program.processArguments(argc, argv)) {
+		const EdgeAlgorithms::EdgeMode mode = program.processArguments(argc, argv);
+		if (mode == EdgeAlgorithms::AUTOTUNE) {
+			program.autotune();
+		}
+		else if (mode) {
 			program.printInfo();
 			program.loadImage();
 			program.perform();